@@ -0,0 +1,40 @@
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Graceful upgrade: a running server listens on a per-user Unix socket; a new
+// process started with --takeover connects to it and receives the live
+// fds (SCM_RIGHTS) plus a ServerNode snapshot, then acks with a token
+// derived from the restored state. The old process answers with a commit
+// and exits; the new one only starts serving once it has that commit, so
+// the two never serve the same fds. Only a peer running the same binary
+// under the same uid is served.
+namespace HotRestart {
+    constexpr size_t MAX_SNAPSHOT_BYTES = 64 * 1024 * 1024;
+
+    // Lives in $XDG_RUNTIME_DIR or a private /tmp/tsamgroup117-<uid>; empty if neither is usable.
+    std::string socket_path(unsigned short port);
+
+    bool send_state(int sock, const std::vector<int> &fds, const std::string &snapshot);
+
+    bool receive_state(int sock, std::vector<int> &fds, std::string &snapshot);
+
+    bool peer_is_same_binary(int sock);
+
+    std::string ack_token(const std::string &group_id, size_t connections);
+
+    void set_timeout(int sock, int timeout_ms);
+
+    bool send_ack(int sock, const std::string &token);
+
+    bool wait_for_ack(int sock, const std::string &token);
+
+    bool send_commit(int sock);
+
+    bool wait_for_commit(int sock);
+}
+
+#endif
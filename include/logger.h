@@ -7,6 +7,7 @@ class Logger {
 public:
     static void init(const std::string &filename = "server_log.txt");
     static void log(const std::string &msg);
+    static void set_enabled(bool enabled);
 };
 
 #endif
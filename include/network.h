@@ -16,5 +16,13 @@ namespace NetworkManager {
     ssize_t send_all(int sockfd, const std::string &data);
 
     ssize_t receive(int sockfd, std::vector<char>& buffer);
+
+    int create_unix_listen_socket(const std::string &path, int backlog = 1);
+
+    int connect_unix(const std::string &path);
+
+    bool send_fds(int sockfd, const std::vector<int> &fds);
+
+    ssize_t receive_fds(int sockfd, std::vector<int> &fds, size_t max_fds);
 }
 #endif
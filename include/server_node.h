@@ -0,0 +1,76 @@
+#ifndef SERVER_NODE_H
+#define SERVER_NODE_H
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+struct ConnInfo {
+    int sock;
+    enum Type { UNKNOWN = 0, CLIENT = 1, SERVERPEER = 2 } type;
+    std::string peer_addr;
+    std::string peer_group;
+    std::string recvbuf;
+    ConnInfo() : sock(-1), type(UNKNOWN) {}
+};
+
+struct NodeStats {
+    uint64_t payloads_handled = 0;
+    uint64_t frames_forwarded = 0;
+    uint64_t messages_stored = 0;
+};
+
+// Server core without any sockets of its own: bytes come in through
+// receive_data() and go out through the send function, so the same code
+// runs behind select() in tsamgroup117 or inside the simulator.
+class ServerNode {
+public:
+    using Clock = std::chrono::steady_clock;
+    using SendFn = std::function<ssize_t(int sock, const std::string &data)>;
+    using StoreFn = std::function<void(const std::string &from_group, const std::string &content)>;
+
+    ServerNode(const std::string &group_id, unsigned short listen_port, SendFn send_fn,
+               Clock::time_point now = Clock::now());
+
+    void add_connection(int sock, const std::string &peer_addr);
+    void connect_peer(int sock, const std::string &peer_addr);
+    void receive_data(int sock, const char *data, size_t len);
+    void remove_connection(int sock);
+    void tick(Clock::time_point now);
+
+    // Hot restart: snapshot() appends every connection's fd to fds and
+    // refers to them by index; restore() rebuilds state from the same fds
+    // as received in the new process.
+    std::string snapshot(std::vector<int> &fds) const;
+    bool restore(const std::string &data, const std::vector<int> &fds);
+
+    void set_store_hook(StoreFn fn) { on_store_ = std::move(fn); }
+
+    const std::string &group_id() const { return group_id_; }
+    const std::map<int, ConnInfo> &connections() const { return conns_; }
+    const NodeStats &stats() const { return stats_; }
+    size_t memory_usage() const;
+
+private:
+    void handle_payload(int sock, const std::string &payload, bool is_framed);
+    void forward_frame_to_peers(int origin_sock, const std::string &frame);
+    void store_message(const std::string &to_group, const std::string &from_group, const std::string &content);
+    std::string build_SERVERS_response() const;
+
+    std::string group_id_;
+    unsigned short listen_port_;
+    SendFn send_;
+    StoreFn on_store_;
+    std::map<int, ConnInfo> conns_;
+    std::map<std::string, std::vector<std::string>> msgs_for_group_;
+    Clock::time_point last_keepalive_time_;
+    NodeStats stats_;
+};
+
+#endif
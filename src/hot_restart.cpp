@@ -0,0 +1,161 @@
+#include "../include/hot_restart.h"
+#include "../include/network.h"
+
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace HotRestart {
+
+// Stays below the kernel's SCM_MAX_FD (253) per message.
+constexpr size_t FDS_PER_MSG = 200;
+const std::string COMMIT = "GO\n";
+// The server selects on everything it adopts, so more than FD_SETSIZE fds is bogus.
+constexpr size_t MAX_HANDOFF_FDS = FD_SETSIZE;
+
+// A usable runtime directory is a real directory owned by us that nobody else can enter.
+static bool is_private_dir(const std::string &dir) {
+    struct stat st;
+    if (lstat(dir.c_str(), &st) < 0) return false;
+    return S_ISDIR(st.st_mode) && st.st_uid == getuid() && (st.st_mode & (S_IRWXG | S_IRWXO)) == 0;
+}
+
+static std::string runtime_dir() {
+    const char *xdg = getenv("XDG_RUNTIME_DIR");
+    if (xdg != nullptr && *xdg == '/' && is_private_dir(xdg)) return xdg;
+
+    std::string dir = "/tmp/tsamgroup117-" + std::to_string(getuid());
+    if (mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST) return "";
+    return is_private_dir(dir) ? dir : "";
+}
+
+std::string socket_path(unsigned short port) {
+    std::string dir = runtime_dir();
+    if (dir.empty()) return "";
+    return dir + "/tsamgroup117_" + std::to_string(port) + ".sock";
+}
+
+// Like NetworkManager::send_all, but a vanished peer must not raise SIGPIPE.
+static bool send_exact(int sock, const std::string &data) {
+    size_t total = 0;
+    while (total < data.size()) {
+        ssize_t n = send(sock, data.data() + total, data.size() - total, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        total += (size_t)n;
+    }
+    return true;
+}
+
+static bool recv_exact(int sock, char *buf, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = recv(sock, buf + total, len - total, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return false;
+        total += (size_t)n;
+    }
+    return true;
+}
+
+bool send_state(int sock, const std::vector<int> &fds, const std::string &snapshot) {
+    if (fds.size() > MAX_HANDOFF_FDS || snapshot.size() > MAX_SNAPSHOT_BYTES) return false;
+    uint32_t header[2] = { htonl((uint32_t)fds.size()), htonl((uint32_t)snapshot.size()) };
+    std::string hdr((const char*)header, sizeof(header));
+    if (!send_exact(sock, hdr)) return false;
+
+    for (size_t i = 0; i < fds.size(); i += FDS_PER_MSG) {
+        size_t end = std::min(fds.size(), i + FDS_PER_MSG);
+        std::vector<int> batch(fds.begin() + i, fds.begin() + end);
+        if (!NetworkManager::send_fds(sock, batch)) return false;
+    }
+    return send_exact(sock, snapshot);
+}
+
+bool receive_state(int sock, std::vector<int> &fds, std::string &snapshot) {
+    uint32_t header[2];
+    if (!recv_exact(sock, (char*)header, sizeof(header))) return false;
+    size_t fd_count = ntohl(header[0]);
+    size_t snap_len = ntohl(header[1]);
+    if (fd_count > MAX_HANDOFF_FDS || snap_len > MAX_SNAPSHOT_BYTES) return false;
+
+    while (fds.size() < fd_count) {
+        if (NetworkManager::receive_fds(sock, fds, FDS_PER_MSG) <= 0) return false;
+    }
+    if (fds.size() != fd_count) return false;
+
+    snapshot.assign(snap_len, '\0');
+    return snap_len == 0 || recv_exact(sock, snapshot.data(), snap_len);
+}
+
+static std::string exe_path(const std::string &link) {
+    char buf[PATH_MAX];
+    ssize_t n = readlink(link.c_str(), buf, sizeof(buf));
+    if (n <= 0) return "";
+    std::string path(buf, (size_t)n);
+    // A rebuilt binary replaces the file the old process was started from.
+    const std::string deleted = " (deleted)";
+    if (path.size() > deleted.size() && path.compare(path.size() - deleted.size(), deleted.size(), deleted) == 0) {
+        path.erase(path.size() - deleted.size());
+    }
+    return path;
+}
+
+bool peer_is_same_binary(int sock) {
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) return false;
+    if (cred.uid != getuid()) return false;
+    std::string self = exe_path("/proc/self/exe");
+    return !self.empty() && self == exe_path("/proc/" + std::to_string(cred.pid) + "/exe");
+}
+
+std::string ack_token(const std::string &group_id, size_t connections) {
+    return "ACK," + group_id + "," + std::to_string(connections) + "\n";
+}
+
+void set_timeout(int sock, int timeout_ms) {
+    timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+bool send_ack(int sock, const std::string &token) {
+    return send_exact(sock, token);
+}
+
+bool wait_for_ack(int sock, const std::string &token) {
+    std::string got(token.size(), '\0');
+    return recv_exact(sock, got.data(), got.size()) && got == token;
+}
+
+bool send_commit(int sock) {
+    return send_exact(sock, COMMIT);
+}
+
+bool wait_for_commit(int sock) {
+    std::string got(COMMIT.size(), '\0');
+    return recv_exact(sock, got.data(), got.size()) && got == COMMIT;
+}
+
+}
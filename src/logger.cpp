@@ -1,4 +1,5 @@
 #include "../include/logger.h"
+#include <atomic>
 #include <chrono>
 #include <ctime>
 #include <fstream>
@@ -8,6 +9,7 @@
 
 static std::string g_logfile = "server_log.txt";
 static std::mutex g_log_mtx;
+static std::atomic<bool> g_log_enabled{true};
 
 void Logger::init(const std::string &filename) {
     std::lock_guard<std::mutex> lk(g_log_mtx);
@@ -16,7 +18,12 @@ void Logger::init(const std::string &filename) {
     (void)ofs;
 }
 
+void Logger::set_enabled(bool enabled) {
+    g_log_enabled = enabled;
+}
+
 void Logger::log(const std::string &msg) {
+    if (!g_log_enabled) return;
     auto now = std::chrono::system_clock::now();
     std::time_t t = std::chrono::system_clock::to_time_t(now);
     std::tm tmbuf;
@@ -7,6 +7,7 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <cstring>
@@ -108,5 +109,99 @@ ssize_t receive(int sockfd, std::vector<char>& buffer) {
     return bytes_read;
 }
 
+static bool fill_unix_addr(const std::string &path, sockaddr_un &addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+int create_unix_listen_socket(const std::string &path, int backlog) {
+    sockaddr_un addr;
+    if (!fill_unix_addr(path, addr)) return -1;
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    unlink(path.c_str());
+    if (bind(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(s);
+        return -1;
+    }
+    if (listen(s, backlog) < 0) {
+        close(s);
+        return -1;
+    }
+    set_nonblocking(s);
+    return s;
 }
 
+int connect_unix(const std::string &path) {
+    sockaddr_un addr;
+    if (!fill_unix_addr(path, addr)) return -1;
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+// Passes fds over a Unix socket as SCM_RIGHTS attached to a single marker byte.
+bool send_fds(int sockfd, const std::vector<int> &fds) {
+    if (fds.empty()) return true;
+    char marker = 'F';
+    iovec iov{&marker, 1};
+    std::vector<char> ctrl(CMSG_SPACE(sizeof(int) * fds.size()), 0);
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.data();
+    msg.msg_controllen = ctrl.size();
+
+    cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    std::memcpy(CMSG_DATA(cm), fds.data(), sizeof(int) * fds.size());
+
+    while (true) {
+        ssize_t n = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        return n == 1;
+    }
+}
+
+ssize_t receive_fds(int sockfd, std::vector<int> &fds, size_t max_fds) {
+    char marker;
+    iovec iov{&marker, 1};
+    std::vector<char> ctrl(CMSG_SPACE(sizeof(int) * max_fds), 0);
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.data();
+    msg.msg_controllen = ctrl.size();
+
+    ssize_t n;
+    do {
+        n = recvmsg(sockfd, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+
+    size_t received = 0;
+    for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int *data = (const int*)CMSG_DATA(cm);
+        fds.insert(fds.end(), data, data + count);
+        received += count;
+    }
+    if (msg.msg_flags & MSG_CTRUNC) return -1;
+    return (ssize_t)received;
+}
+
+}
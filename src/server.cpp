@@ -1,78 +1,123 @@
 #include "../include/common.h"
+#include "../include/hot_restart.h"
 #include "../include/logger.h"
 #include "../include/network.h"
-#include "../include/protocol.h"
+#include "../include/server_node.h"
 
 #include <sys/select.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <chrono> 
 #include <iostream>
-#include <map>
-#include <sstream>
 #include <string>
 #include <vector>
 #include <cstring>
 
-struct ConnInfo {
-    int sock;
-    enum Type { UNKNOWN = 0, CLIENT = 1, SERVERPEER = 2 } type;
-    std::string peer_addr;
-    std::string peer_group;
-    std::string recvbuf;
-    ConnInfo() : sock(-1), type(UNKNOWN) {}
-};
+// The old process handles a takeover inside its select loop, so keep the
+// stall short; the new process can afford to wait longer for the old one.
+constexpr int HANDOFF_TIMEOUT_MS = 500;
+constexpr int TAKEOVER_TIMEOUT_MS = 5000;
 
-static std::map<int, ConnInfo> conns;
-static std::map<std::string, std::vector<std::string>> msgs_for_group;
-static unsigned short g_listen_port = 0;
-static std::string g_group_id = "A5_117";
-
-static void handle_payload(int sock, const std::string& payload, bool is_framed);
-static void forward_frame_to_peers(int origin_sock, const std::string& frame);
+static void add_new_socket_to_master(int sock, fd_set* master, int* maxfd) {
+    FD_SET(sock, master);
+    if (sock > *maxfd) *maxfd = sock;
+}
 
-static std::string build_SERVERS_response() {
-    std::ostringstream ss;
-    ss << "SERVERS";
-    ss << "," << g_group_id << ",0.0.0.0," << g_listen_port;
+// New process side of a hot restart: adopt the listen socket, connections and
+// message store of the server currently running on this port.
+static int take_over(ServerNode &node, unsigned short port) {
+    std::string path = HotRestart::socket_path(port);
+    if (path.empty()) {
+        Logger::log("Takeover failed: no private runtime directory for the handoff socket");
+        return -1;
+    }
+    int sock = NetworkManager::connect_unix(path);
+    if (sock < 0) {
+        Logger::log("Takeover failed: no running server at " + path);
+        return -1;
+    }
+    // Whoever owns that socket hands us every fd we will serve, so it must be us.
+    if (!HotRestart::peer_is_same_binary(sock)) {
+        Logger::log("Takeover failed: " + path + " is not served by this server binary");
+        close(sock);
+        return -1;
+    }
+    HotRestart::set_timeout(sock, TAKEOVER_TIMEOUT_MS);
+
+    std::vector<int> fds;
+    std::string snapshot;
+    bool ok = HotRestart::receive_state(sock, fds, snapshot) && !fds.empty();
+    if (ok) {
+        int accepting = 0;
+        socklen_t optlen = sizeof(accepting);
+        ok = getsockopt(fds[0], SOL_SOCKET, SO_ACCEPTCONN, &accepting, &optlen) == 0 && accepting;
+    }
+    if (!ok || !node.restore(snapshot, fds)) {
+        Logger::log("Takeover failed: could not restore state from old process");
+        for (int fd : fds) close(fd);
+        close(sock);
+        return -1;
+    }
 
-    for (auto const& [sock, ci] : conns) {
-        if (ci.type != ConnInfo::SERVERPEER || ci.peer_group.empty()) continue;
-        std::string ip = ci.peer_addr;
-        std::string ip_only = ip;
-        std::string port = "0";
-        auto p = ip.find(':');
-        if (p != std::string::npos) {
-            ip_only = ip.substr(0, p);
-            port = ip.substr(p + 1);
-        }
-        ss << ";" << ci.peer_group << "," << ip_only << "," << port;
+    // Until the old process commits it may still be serving these fds.
+    std::string token = HotRestart::ack_token(node.group_id(), node.connections().size());
+    if (!HotRestart::send_ack(sock, token) || !HotRestart::wait_for_commit(sock)) {
+        Logger::log("Takeover failed: old process did not commit the handoff");
+        for (int fd : fds) close(fd);
+        close(sock);
+        return -1;
     }
-    return ss.str();
+    close(sock);
+
+    Logger::log("Took over " + std::to_string(node.connections().size()) + " connections from old process");
+    return fds[0];
 }
 
-static void add_new_socket_to_master(int sock, fd_set* master, int* maxfd, const std::string& peer_addr) {
-    FD_SET(sock, master);
-    if (sock > *maxfd) *maxfd = sock;
-    ConnInfo ci;
-    ci.sock = sock;
-    ci.type = ConnInfo::UNKNOWN;
-    ci.peer_addr = peer_addr;
-    conns[sock] = ci;
-    Logger::log("Registered new connection from " + peer_addr + " on sock " + std::to_string(sock));
+// Old process side: ship everything to the new process and report whether the
+// handoff was committed, in which case the caller must exit without touching the sockets.
+static bool hand_off(const ServerNode &node, int listenfd, int handoff_fd) {
+    int c = accept(handoff_fd, nullptr, nullptr);
+    if (c < 0) return false;
+    if (!HotRestart::peer_is_same_binary(c)) {
+        Logger::log("Rejected hot restart request from a process that is not this server binary");
+        close(c);
+        return false;
+    }
+    HotRestart::set_timeout(c, HANDOFF_TIMEOUT_MS);
+
+    std::vector<int> fds{listenfd};
+    std::string snapshot = node.snapshot(fds);
+    Logger::log("Hot restart requested, handing off " + std::to_string(fds.size() - 1) + " connections");
+
+    bool ok = HotRestart::send_state(c, fds, snapshot) &&
+              HotRestart::wait_for_ack(c, HotRestart::ack_token(node.group_id(), fds.size() - 1)) &&
+              HotRestart::send_commit(c);
+    if (!ok) {
+        // Without a commit the new process gives up, even if its ack arrives late.
+        shutdown(c, SHUT_RDWR);
+        Logger::log("Hot restart handoff failed, continuing to serve");
+    }
+    close(c);
+    return ok;
 }
 
 int main(int argc, char* argv[]) {
     if (argc < 3) {
         fprintf(stderr, "Usage: %s <listen_port> <group_id> [peer1_ip:port] [peer2_ip:port] ...\n", argv[0]);
+        fprintf(stderr, "       %s <listen_port> <group_id> --takeover\n", argv[0]);
         return 1;
     }
-    g_listen_port = (unsigned short)atoi(argv[1]);
-    g_group_id = argv[2];
+    unsigned short listen_port = (unsigned short)atoi(argv[1]);
+    std::string group_id = argv[2];
+    bool takeover = argc >= 4 && std::string(argv[3]) == "--takeover";
 
     Logger::init("server_log.txt");
-    Logger::log("Starting server for group: " + g_group_id + " on port " + std::to_string(g_listen_port));
+    Logger::log("Starting server for group: " + group_id + " on port " + std::to_string(listen_port));
 
-    int listenfd = NetworkManager::create_listen_socket(g_listen_port);
+    ServerNode node(group_id, listen_port, NetworkManager::send_all);
+
+    int listenfd = takeover ? take_over(node, listen_port)
+                            : NetworkManager::create_listen_socket(listen_port);
     if (listenfd < 0) {
         Logger::log("Fatal: Failed to create listen socket");
         return 1;
@@ -83,7 +128,9 @@ int main(int argc, char* argv[]) {
     FD_SET(listenfd, &master);
     int maxfd = listenfd;
 
-    for (int i = 3; i < argc; ++i) {
+    for (auto const& [sock, ci] : node.connections()) add_new_socket_to_master(sock, &master, &maxfd);
+
+    for (int i = 3; i < argc && !takeover; ++i) {
         std::string peer_str = argv[i];
         auto colon_pos = peer_str.find(':');
         if (colon_pos == std::string::npos) {
@@ -96,18 +143,22 @@ int main(int argc, char* argv[]) {
         Logger::log("Attempting to connect to peer " + host + ":" + std::to_string(port));
         int peer_sock = NetworkManager::connect_to(host, port);
         if (peer_sock >= 0) {
-            add_new_socket_to_master(peer_sock, &master, &maxfd, peer_str);
-            conns[peer_sock].type = ConnInfo::SERVERPEER;
-            std::string helo_payload = "HELO," + g_group_id;
-            std::string frame = ProtocolHandler::build_frame(helo_payload);
-            NetworkManager::send_all(peer_sock, frame);
+            add_new_socket_to_master(peer_sock, &master, &maxfd);
+            node.connect_peer(peer_sock, peer_str);
             Logger::log("Successfully connected to peer and sent HELO.");
         } else {
             Logger::log("Failed to connect to peer " + peer_str);
         }
     }
-    
-    auto last_keepalive_time = std::chrono::steady_clock::now();
+
+    std::string handoff_path = HotRestart::socket_path(listen_port);
+    int handoff_fd = handoff_path.empty() ? -1 : NetworkManager::create_unix_listen_socket(handoff_path);
+    if (handoff_fd >= 0) {
+        add_new_socket_to_master(handoff_fd, &master, &maxfd);
+    } else {
+        Logger::log("Hot restart unavailable: could not listen on " +
+                    (handoff_path.empty() ? std::string("a private runtime directory") : handoff_path));
+    }
 
     while (true) {
         fd_set readfs = master;
@@ -122,217 +173,57 @@ int main(int argc, char* argv[]) {
             Logger::log("select() error, exiting");
             break;
         }
-        
-        auto now = std::chrono::steady_clock::now();
-        if (std::chrono::duration_cast<std::chrono::seconds>(now - last_keepalive_time).count() >= 60) {
-            Logger::log("Sending KEEPALIVE to peers.");
-            for(auto const& [sock, ci] : conns) {
-                if (ci.type == ConnInfo::SERVERPEER) {
-                    int msg_count = 0;
-                    if (!ci.peer_group.empty() && msgs_for_group.count(ci.peer_group)) {
-                        msg_count = msgs_for_group.at(ci.peer_group).size();
-                    }
-                    std::string payload = "KEEPALIVE," + std::to_string(msg_count);
-                    std::string frame = ProtocolHandler::build_frame(payload);
-                    NetworkManager::send_all(sock, frame);
-                }
+
+        if (handoff_fd >= 0 && FD_ISSET(handoff_fd, &readfs)) {
+            if (hand_off(node, listenfd, handoff_fd)) {
+                Logger::log("Handed off to new process, exiting.");
+                return 0;
             }
-            last_keepalive_time = now;
         }
 
+        node.tick(std::chrono::steady_clock::now());
+
         if (FD_ISSET(listenfd, &readfs)) {
             std::string peer_ip;
             int c = NetworkManager::accept_nonblocking(listenfd, &peer_ip);
             if (c >= 0) {
-                add_new_socket_to_master(c, &master, &maxfd, peer_ip);
+                add_new_socket_to_master(c, &master, &maxfd);
+                node.add_connection(c, peer_ip);
             }
         }
 
         std::vector<int> to_erase;
-        for (auto& pair : conns) {
-            int s = pair.first;
-            ConnInfo& ci = pair.second;
-
-            if (FD_ISSET(s, &readfs)) {
-                std::vector<char> received_data;
-                ssize_t r = NetworkManager::receive(s, received_data);
-
-                if (r <= 0) {
-                    if (r == 0) Logger::log("Connection closed by peer: " + ci.peer_addr);
-                    else Logger::log(std::string("recv error on sock ") + std::to_string(s) + ": " + strerror(errno));
-                    to_erase.push_back(s);
-                    continue;
-                }
-
-                ci.recvbuf.append(received_data.begin(), received_data.end());
-
-                std::vector<std::string> framed_payloads;
-                ProtocolHandler::extract_frames_from_buffer(ci.recvbuf, framed_payloads);
-                for (const auto& pl : framed_payloads) {
-                    handle_payload(s, pl, true);
-                }
-
-                size_t newline_pos;
-                while ((newline_pos = ci.recvbuf.find('\n')) != std::string::npos) {
-                    std::string client_payload = ci.recvbuf.substr(0, newline_pos);
-                    if (!client_payload.empty() && client_payload.back() == '\r') {
-                        client_payload.pop_back();
-                    }
-                    
-                    if (!client_payload.empty()) {
-                        handle_payload(s, client_payload, false);
-                    }
-                    ci.recvbuf.erase(0, newline_pos + 1);
-                }
+        std::vector<int> readable;
+        for (auto const& [s, ci] : node.connections()) {
+            if (FD_ISSET(s, &readfs)) readable.push_back(s);
+        }
+        for (int s : readable) {
+            std::vector<char> received_data;
+            ssize_t r = NetworkManager::receive(s, received_data);
+
+            if (r <= 0) {
+                if (r == 0) Logger::log("Connection closed by peer: " + node.connections().at(s).peer_addr);
+                else Logger::log(std::string("recv error on sock ") + std::to_string(s) + ": " + strerror(errno));
+                to_erase.push_back(s);
+                continue;
             }
+
+            node.receive_data(s, received_data.data(), received_data.size());
         }
 
         for (int s : to_erase) {
             close(s);
             FD_CLR(s, &master);
-            conns.erase(s);
+            node.remove_connection(s);
         }
     }
 
-    for (auto const& [sock, conn_info] : conns) close(sock);
+    for (auto const& [sock, conn_info] : node.connections()) close(sock);
     close(listenfd);
-    return 0;
-}
-
-
-static void handle_payload(int sock, const std::string& payload, bool is_framed) {
-    Logger::log("Payload from sock " + std::to_string(sock) + " (framed: " + (is_framed ? "yes" : "no") + "): " + payload);
-    std::vector<std::string> tokens;
-    std::istringstream ss(payload);
-    std::string tok;
-    while (std::getline(ss, tok, ',')) {
-        tokens.push_back(tok);
-    }
-    if (tokens.empty()) return;
-
-    std::string command = tokens[0];
-    ConnInfo& ci = conns.at(sock);
-
-    if (command == "HELO") {
-        ci.type = ConnInfo::SERVERPEER;
-        ci.peer_group = (tokens.size() >= 2 ? tokens[1] : "unknown");
-        Logger::log("Peer " + ci.peer_group + " said HELO from " + ci.peer_addr);
-        std::string resp = build_SERVERS_response();
-        NetworkManager::send_all(sock, ProtocolHandler::build_frame(resp));
-    }
-    else if (command == "SERVERS") {
-        Logger::log("Received SERVERS list from peer: " + payload);
-    }
-    else if (command == "KEEPALIVE") {
-         Logger::log("Received KEEPALIVE from " + ci.peer_group);
-    }
-    else if (command == "SENDMSG") {
-
-        std::string to_group, from_group, content, full_payload;
-
-        if (!is_framed && tokens.size() >= 2) {
-            if (ci.type == ConnInfo::UNKNOWN) ci.type = ConnInfo::CLIENT;
-            
-            to_group = tokens[1];
-            from_group = g_group_id;
-
-            auto first_comma = payload.find(',');
-            auto second_comma = payload.find(',', first_comma + 1);
-            content = payload.substr(second_comma + 1);
-
-            full_payload = "SENDMSG," + to_group + "," + from_group + "," + content;
-            Logger::log("Received SENDMSG from client. Full command: " + full_payload);
-        }
-        else if (is_framed && tokens.size() >= 4) {
-            to_group = tokens[1];
-            from_group = tokens[2];
-            
-            auto first_comma = payload.find(',');
-            auto second_comma = payload.find(',', first_comma + 1);
-            auto third_comma = payload.find(',', second_comma + 1);
-            content = payload.substr(third_comma + 1);
-            full_payload = payload;
-        } else {
-            Logger::log("Malformed SENDMSG command: " + payload);
-            return;
-        }
-
-        if (content.size() > MSG_LIMIT) content.resize(MSG_LIMIT);
-
-        if (to_group == g_group_id) {
-            msgs_for_group[to_group].push_back(from_group + "|" + content);
-            Logger::log("Stored message for my group (" + to_group + ") from " + from_group);
-        } else {
-            Logger::log("Forwarding message for " + to_group + " from " + from_group);
-            std::string forward_frame = ProtocolHandler::build_frame(full_payload);
-            forward_frame_to_peers(sock, forward_frame);
-        }
-    }
-    else if (command == "STATUSREQ") {
-        if (ci.type == ConnInfo::UNKNOWN) { ci.type = ConnInfo::CLIENT; }
-        std::ostringstream resp_ss;
-        resp_ss << "STATUSRESP";
-        for (auto const& [group, msg_list] : msgs_for_group) {
-            if (!msg_list.empty()) {
-                resp_ss << "," << group << "," << msg_list.size();
-            }
-        }
-        std::string response_str = resp_ss.str();
-        Logger::log("Responding to STATUSREQ with: " + response_str);
-
-        if (ci.type == ConnInfo::CLIENT) {
-             NetworkManager::send_all(sock, response_str + "\n");
-        } else {
-             NetworkManager::send_all(sock, ProtocolHandler::build_frame(response_str));
-        }
-    }
-    else if (command == "GETMSGS") {
-        if(tokens.size() >= 2) {
-            std::string requested_group = tokens[1];
-            Logger::log("Peer " + ci.peer_group + " is requesting messages for group " + requested_group);
-            auto it = msgs_for_group.find(requested_group);
-            if (it != msgs_for_group.end()) {
-                for(const auto& msg_entry : it->second) {
-                    auto pipe_pos = msg_entry.find('|');
-                    std::string from_group = msg_entry.substr(0, pipe_pos);
-                    std::string content = msg_entry.substr(pipe_pos + 1);
-                    std::string msg_payload = "SENDMSG," + requested_group + "," + from_group + "," + content;
-                    NetworkManager::send_all(sock, ProtocolHandler::build_frame(msg_payload));
-                }
-                it->second.clear();
-            }
-        }
-    }
-    else if (command == "GETMSG") {
-        ci.type = ConnInfo::CLIENT;
-        std::string response_payload;
-        auto it = msgs_for_group.find(g_group_id);
-        if (it != msgs_for_group.end() && !it->second.empty()) {
-            std::string entry = it->second.front();
-            it->second.erase(it->second.begin());
-            
-            auto pipe_pos = entry.find('|');
-            std::string from_group = entry.substr(0, pipe_pos);
-            std::string content = entry.substr(pipe_pos + 1);
-            response_payload = "MSG," + from_group + "," + content;
-            Logger::log("Delivering message to client from " + from_group);
-        } else {
-            response_payload = "NO_MSG";
-        }
-        NetworkManager::send_all(sock, response_payload + "\n");
-    } else if (command == "LISTSERVERS") {
-        ci.type = ConnInfo::CLIENT;
-        std::string response = build_SERVERS_response();
-        NetworkManager::send_all(sock, response + "\n");
-    } else {
-        Logger::log("Unknown command received: " + payload);
+    if (handoff_fd >= 0) {
+        close(handoff_fd);
+        unlink(handoff_path.c_str());
     }
+    return 0;
 }
 
-static void forward_frame_to_peers(int origin_sock, const std::string& frame) {
-    for (auto const& [peer_sock, ci] : conns) {
-        if (ci.type == ConnInfo::SERVERPEER && peer_sock != origin_sock) {
-            NetworkManager::send_all(peer_sock, frame);
-        }
-    }
-}
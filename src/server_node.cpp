@@ -0,0 +1,362 @@
+#include "../include/server_node.h"
+#include "../include/common.h"
+#include "../include/logger.h"
+#include "../include/protocol.h"
+
+#include <arpa/inet.h>
+
+#include <cstring>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+ServerNode::ServerNode(const std::string &group_id, unsigned short listen_port, SendFn send_fn,
+                       Clock::time_point now)
+    : group_id_(group_id), listen_port_(listen_port), send_(std::move(send_fn)), last_keepalive_time_(now) {}
+
+std::string ServerNode::build_SERVERS_response() const {
+    std::ostringstream ss;
+    ss << "SERVERS";
+    ss << "," << group_id_ << ",0.0.0.0," << listen_port_;
+
+    for (auto const& [sock, ci] : conns_) {
+        if (ci.type != ConnInfo::SERVERPEER || ci.peer_group.empty()) continue;
+        std::string ip = ci.peer_addr;
+        std::string ip_only = ip;
+        std::string port = "0";
+        auto p = ip.find(':');
+        if (p != std::string::npos) {
+            ip_only = ip.substr(0, p);
+            port = ip.substr(p + 1);
+        }
+        ss << ";" << ci.peer_group << "," << ip_only << "," << port;
+    }
+    return ss.str();
+}
+
+void ServerNode::add_connection(int sock, const std::string &peer_addr) {
+    ConnInfo ci;
+    ci.sock = sock;
+    ci.type = ConnInfo::UNKNOWN;
+    ci.peer_addr = peer_addr;
+    conns_[sock] = ci;
+    Logger::log("Registered new connection from " + peer_addr + " on sock " + std::to_string(sock));
+}
+
+void ServerNode::connect_peer(int sock, const std::string &peer_addr) {
+    add_connection(sock, peer_addr);
+    conns_[sock].type = ConnInfo::SERVERPEER;
+    std::string helo_payload = "HELO," + group_id_;
+    send_(sock, ProtocolHandler::build_frame(helo_payload));
+}
+
+void ServerNode::remove_connection(int sock) {
+    conns_.erase(sock);
+}
+
+void ServerNode::tick(Clock::time_point now) {
+    if (std::chrono::duration_cast<std::chrono::seconds>(now - last_keepalive_time_).count() < 60) return;
+
+    Logger::log("Sending KEEPALIVE to peers.");
+    for (auto const& [sock, ci] : conns_) {
+        if (ci.type == ConnInfo::SERVERPEER) {
+            int msg_count = 0;
+            if (!ci.peer_group.empty() && msgs_for_group_.count(ci.peer_group)) {
+                msg_count = msgs_for_group_.at(ci.peer_group).size();
+            }
+            std::string payload = "KEEPALIVE," + std::to_string(msg_count);
+            send_(sock, ProtocolHandler::build_frame(payload));
+        }
+    }
+    last_keepalive_time_ = now;
+}
+
+void ServerNode::receive_data(int sock, const char *data, size_t len) {
+    auto it = conns_.find(sock);
+    if (it == conns_.end()) return;
+    ConnInfo& ci = it->second;
+
+    ci.recvbuf.append(data, len);
+
+    std::vector<std::string> framed_payloads;
+    ProtocolHandler::extract_frames_from_buffer(ci.recvbuf, framed_payloads);
+    for (const auto& pl : framed_payloads) {
+        handle_payload(sock, pl, true);
+    }
+
+    size_t newline_pos;
+    while ((newline_pos = ci.recvbuf.find('\n')) != std::string::npos) {
+        std::string client_payload = ci.recvbuf.substr(0, newline_pos);
+        if (!client_payload.empty() && client_payload.back() == '\r') {
+            client_payload.pop_back();
+        }
+
+        if (!client_payload.empty()) {
+            handle_payload(sock, client_payload, false);
+        }
+        ci.recvbuf.erase(0, newline_pos + 1);
+    }
+}
+
+static const char SNAPSHOT_MAGIC[] = "TSAMSNAP1";
+
+static void put_u32(std::string &out, uint32_t v) {
+    uint32_t net = htonl(v);
+    out.append((const char*)&net, sizeof(net));
+}
+
+static void put_str(std::string &out, const std::string &v) {
+    put_u32(out, (uint32_t)v.size());
+    out += v;
+}
+
+static bool get_u32(const std::string &in, size_t &pos, uint32_t &v) {
+    if (in.size() - pos < sizeof(v)) return false;
+    uint32_t net;
+    std::memcpy(&net, in.data() + pos, sizeof(net));
+    v = ntohl(net);
+    pos += sizeof(net);
+    return true;
+}
+
+static bool get_str(const std::string &in, size_t &pos, std::string &v) {
+    uint32_t len;
+    if (!get_u32(in, pos, len) || in.size() - pos < len) return false;
+    v = in.substr(pos, len);
+    pos += len;
+    return true;
+}
+
+std::string ServerNode::snapshot(std::vector<int> &fds) const {
+    std::string out;
+    put_str(out, SNAPSHOT_MAGIC);
+    put_str(out, group_id_);
+    put_u32(out, (uint32_t)conns_.size());
+    for (auto const& [sock, ci] : conns_) {
+        put_u32(out, (uint32_t)fds.size());
+        fds.push_back(sock);
+        put_u32(out, (uint32_t)ci.type);
+        put_str(out, ci.peer_addr);
+        put_str(out, ci.peer_group);
+        put_str(out, ci.recvbuf);
+    }
+    put_u32(out, (uint32_t)msgs_for_group_.size());
+    for (auto const& [group, msg_list] : msgs_for_group_) {
+        put_str(out, group);
+        put_u32(out, (uint32_t)msg_list.size());
+        for (const auto& m : msg_list) put_str(out, m);
+    }
+    return out;
+}
+
+bool ServerNode::restore(const std::string &data, const std::vector<int> &fds) {
+    size_t pos = 0;
+    std::string magic, group;
+    if (!get_str(data, pos, magic) || magic != SNAPSHOT_MAGIC) return false;
+    if (!get_str(data, pos, group)) return false;
+    if (group != group_id_) {
+        Logger::log("Snapshot belongs to group " + group + ", not " + group_id_);
+        return false;
+    }
+
+    // fds[0] is the listen socket; every other fd must back exactly one connection.
+    std::map<int, ConnInfo> conns;
+    std::set<uint32_t> used;
+    uint32_t conn_count;
+    if (!get_u32(data, pos, conn_count)) return false;
+    for (uint32_t i = 0; i < conn_count; ++i) {
+        uint32_t fd_index, type;
+        ConnInfo ci;
+        if (!get_u32(data, pos, fd_index) || fd_index == 0 || fd_index >= fds.size()) return false;
+        if (!used.insert(fd_index).second) return false;
+        if (!get_u32(data, pos, type) || type > ConnInfo::SERVERPEER) return false;
+        if (!get_str(data, pos, ci.peer_addr) || !get_str(data, pos, ci.peer_group) ||
+            !get_str(data, pos, ci.recvbuf)) return false;
+        ci.sock = fds[fd_index];
+        ci.type = (ConnInfo::Type)type;
+        conns[ci.sock] = ci;
+    }
+    if (fds.empty() || used.size() != fds.size() - 1) return false;
+
+    std::map<std::string, std::vector<std::string>> msgs;
+    uint32_t group_count;
+    if (!get_u32(data, pos, group_count)) return false;
+    for (uint32_t i = 0; i < group_count; ++i) {
+        std::string to_group;
+        uint32_t msg_count;
+        if (!get_str(data, pos, to_group) || !get_u32(data, pos, msg_count)) return false;
+        auto& msg_list = msgs[to_group];
+        for (uint32_t j = 0; j < msg_count; ++j) {
+            std::string m;
+            if (!get_str(data, pos, m)) return false;
+            msg_list.push_back(m);
+        }
+    }
+    if (pos != data.size()) return false;
+
+    conns_ = std::move(conns);
+    msgs_for_group_ = std::move(msgs);
+    return true;
+}
+
+size_t ServerNode::memory_usage() const {
+    // Rough estimate: object itself, map nodes, and heap-allocated string bodies.
+    constexpr size_t map_node_overhead = 4 * sizeof(void*);
+    size_t total = sizeof(*this) + group_id_.capacity();
+    for (auto const& [sock, ci] : conns_) {
+        total += map_node_overhead + sizeof(sock) + sizeof(ci);
+        total += ci.peer_addr.capacity() + ci.peer_group.capacity() + ci.recvbuf.capacity();
+    }
+    for (auto const& [group, msg_list] : msgs_for_group_) {
+        total += map_node_overhead + sizeof(group) + group.capacity() + sizeof(msg_list);
+        total += msg_list.capacity() * sizeof(std::string);
+        for (const auto& m : msg_list) total += m.capacity();
+    }
+    return total;
+}
+
+void ServerNode::store_message(const std::string &to_group, const std::string &from_group, const std::string &content) {
+    msgs_for_group_[to_group].push_back(from_group + "|" + content);
+    ++stats_.messages_stored;
+    if (on_store_) on_store_(from_group, content);
+}
+
+void ServerNode::handle_payload(int sock, const std::string& payload, bool is_framed) {
+    ++stats_.payloads_handled;
+    Logger::log("Payload from sock " + std::to_string(sock) + " (framed: " + (is_framed ? "yes" : "no") + "): " + payload);
+    std::vector<std::string> tokens;
+    std::istringstream ss(payload);
+    std::string tok;
+    while (std::getline(ss, tok, ',')) {
+        tokens.push_back(tok);
+    }
+    if (tokens.empty()) return;
+
+    std::string command = tokens[0];
+    ConnInfo& ci = conns_.at(sock);
+
+    if (command == "HELO") {
+        ci.type = ConnInfo::SERVERPEER;
+        ci.peer_group = (tokens.size() >= 2 ? tokens[1] : "unknown");
+        Logger::log("Peer " + ci.peer_group + " said HELO from " + ci.peer_addr);
+        std::string resp = build_SERVERS_response();
+        send_(sock, ProtocolHandler::build_frame(resp));
+    }
+    else if (command == "SERVERS") {
+        Logger::log("Received SERVERS list from peer: " + payload);
+    }
+    else if (command == "KEEPALIVE") {
+         Logger::log("Received KEEPALIVE from " + ci.peer_group);
+    }
+    else if (command == "SENDMSG") {
+
+        std::string to_group, from_group, content, full_payload;
+
+        if (!is_framed && tokens.size() >= 2) {
+            if (ci.type == ConnInfo::UNKNOWN) ci.type = ConnInfo::CLIENT;
+
+            to_group = tokens[1];
+            from_group = group_id_;
+
+            auto first_comma = payload.find(',');
+            auto second_comma = payload.find(',', first_comma + 1);
+            content = payload.substr(second_comma + 1);
+
+            full_payload = "SENDMSG," + to_group + "," + from_group + "," + content;
+            Logger::log("Received SENDMSG from client. Full command: " + full_payload);
+        }
+        else if (is_framed && tokens.size() >= 4) {
+            to_group = tokens[1];
+            from_group = tokens[2];
+
+            auto first_comma = payload.find(',');
+            auto second_comma = payload.find(',', first_comma + 1);
+            auto third_comma = payload.find(',', second_comma + 1);
+            content = payload.substr(third_comma + 1);
+            full_payload = payload;
+        } else {
+            Logger::log("Malformed SENDMSG command: " + payload);
+            return;
+        }
+
+        if (content.size() > MSG_LIMIT) content.resize(MSG_LIMIT);
+
+        if (to_group == group_id_) {
+            store_message(to_group, from_group, content);
+            Logger::log("Stored message for my group (" + to_group + ") from " + from_group);
+        } else {
+            Logger::log("Forwarding message for " + to_group + " from " + from_group);
+            std::string forward_frame = ProtocolHandler::build_frame(full_payload);
+            forward_frame_to_peers(sock, forward_frame);
+        }
+    }
+    else if (command == "STATUSREQ") {
+        if (ci.type == ConnInfo::UNKNOWN) { ci.type = ConnInfo::CLIENT; }
+        std::ostringstream resp_ss;
+        resp_ss << "STATUSRESP";
+        for (auto const& [group, msg_list] : msgs_for_group_) {
+            if (!msg_list.empty()) {
+                resp_ss << "," << group << "," << msg_list.size();
+            }
+        }
+        std::string response_str = resp_ss.str();
+        Logger::log("Responding to STATUSREQ with: " + response_str);
+
+        if (ci.type == ConnInfo::CLIENT) {
+             send_(sock, response_str + "\n");
+        } else {
+             send_(sock, ProtocolHandler::build_frame(response_str));
+        }
+    }
+    else if (command == "GETMSGS") {
+        if(tokens.size() >= 2) {
+            std::string requested_group = tokens[1];
+            Logger::log("Peer " + ci.peer_group + " is requesting messages for group " + requested_group);
+            auto it = msgs_for_group_.find(requested_group);
+            if (it != msgs_for_group_.end()) {
+                for(const auto& msg_entry : it->second) {
+                    auto pipe_pos = msg_entry.find('|');
+                    std::string from_group = msg_entry.substr(0, pipe_pos);
+                    std::string content = msg_entry.substr(pipe_pos + 1);
+                    std::string msg_payload = "SENDMSG," + requested_group + "," + from_group + "," + content;
+                    send_(sock, ProtocolHandler::build_frame(msg_payload));
+                }
+                it->second.clear();
+            }
+        }
+    }
+    else if (command == "GETMSG") {
+        ci.type = ConnInfo::CLIENT;
+        std::string response_payload;
+        auto it = msgs_for_group_.find(group_id_);
+        if (it != msgs_for_group_.end() && !it->second.empty()) {
+            std::string entry = it->second.front();
+            it->second.erase(it->second.begin());
+
+            auto pipe_pos = entry.find('|');
+            std::string from_group = entry.substr(0, pipe_pos);
+            std::string content = entry.substr(pipe_pos + 1);
+            response_payload = "MSG," + from_group + "," + content;
+            Logger::log("Delivering message to client from " + from_group);
+        } else {
+            response_payload = "NO_MSG";
+        }
+        send_(sock, response_payload + "\n");
+    } else if (command == "LISTSERVERS") {
+        ci.type = ConnInfo::CLIENT;
+        std::string response = build_SERVERS_response();
+        send_(sock, response + "\n");
+    } else {
+        Logger::log("Unknown command received: " + payload);
+    }
+}
+
+void ServerNode::forward_frame_to_peers(int origin_sock, const std::string& frame) {
+    for (auto const& [peer_sock, ci] : conns_) {
+        if (ci.type == ConnInfo::SERVERPEER && peer_sock != origin_sock) {
+            send_(peer_sock, frame);
+            ++stats_.frames_forwarded;
+        }
+    }
+}
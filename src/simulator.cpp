@@ -0,0 +1,317 @@
+#include "../include/logger.h"
+#include "../include/server_node.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// In-process mesh simulator: runs many ServerNode instances over an
+// in-memory transport driven by a deterministic virtual clock.
+
+static constexpr int CLIENT_SINK = -1;
+
+struct Endpoint {
+    int node;
+    int sock;
+    int64_t latency_us;
+};
+
+struct Event {
+    int64_t at_us;
+    uint64_t seq;
+    int node;
+    int sock;
+    std::string data;
+    bool operator>(const Event &o) const {
+        return at_us != o.at_us ? at_us > o.at_us : seq > o.seq;
+    }
+};
+
+struct Delivery {
+    int64_t injected_us = -1;
+    int64_t first_delivery_us = -1;
+    uint64_t copies = 0;
+};
+
+class Simulation {
+public:
+    Simulation(int n, uint64_t seed) : rng_(seed) {
+        links_.resize(n);
+        next_sock_.assign(n, 4);
+        for (int i = 0; i < n; ++i) {
+            auto send_fn = [this, i](int sock, const std::string &data) -> ssize_t {
+                return transmit(i, sock, data);
+            };
+            nodes_.push_back(std::make_unique<ServerNode>(group_of(i), port_of(i), send_fn, clock_at(0)));
+            nodes_.back()->set_store_hook([this](const std::string &, const std::string &content) {
+                record_delivery(content);
+            });
+        }
+    }
+
+    static std::string group_of(int i) { return "SIM_" + std::to_string(i); }
+    static unsigned short port_of(int i) { return (unsigned short)(4000 + i); }
+
+    bool has_link(int a, int b) const { return edges_.count({std::min(a, b), std::max(a, b)}) > 0; }
+
+    void link(int from, int to) {
+        edges_.insert({std::min(from, to), std::max(from, to)});
+        int64_t latency = 500 + (int64_t)(rng_() % 1000);
+        int sf = next_sock_[from]++;
+        int st = next_sock_[to]++;
+        links_[from][sf] = {to, st, latency};
+        links_[to][st] = {from, sf, latency};
+        nodes_[to]->add_connection(st, "127.0.0.1:" + std::to_string(50000 + from));
+        nodes_[from]->connect_peer(sf, "127.0.0.1:" + std::to_string(port_of(to)));
+    }
+
+    size_t inject(int src, int dst, int64_t at_us) {
+        size_t id = deliveries_.size();
+        int sock = next_sock_[src]++;
+        links_[src][sock] = {CLIENT_SINK, -1, 0};
+        nodes_[src]->add_connection(sock, "127.0.0.1:" + std::to_string(60000 + (int)id));
+        deliveries_.emplace_back();
+        schedule(src, sock, "SENDMSG," + group_of(dst) + "," + std::to_string(id) + "\n", at_us);
+        return id;
+    }
+
+    // Processes events until the queue drains (true) or budget events have
+    // been processed with work still pending (false).
+    bool run(uint64_t budget) {
+        uint64_t processed = 0;
+        while (!queue_.empty()) {
+            if (processed >= budget) return false;
+            Event ev = queue_.top();
+            queue_.pop();
+            now_us_ = ev.at_us;
+            ++processed;
+            ++events_processed_;
+            bool injection = links_[ev.node].at(ev.sock).node == CLIENT_SINK;
+            if (injection) {
+                deliveries_[std::stoul(ev.data.substr(ev.data.rfind(',') + 1))].injected_us = now_us_;
+            } else if (ev.data.compare(4, 8, "SENDMSG,") == 0) {
+                ++forwards_processed_;
+            }
+            ServerNode &node = *nodes_[ev.node];
+            node.tick(clock_at(now_us_));
+            node.receive_data(ev.sock, ev.data.data(), ev.data.size());
+            // The injecting client is one-shot; drop it so it doesn't count towards node memory.
+            if (injection) {
+                node.remove_connection(ev.sock);
+                links_[ev.node].erase(ev.sock);
+            }
+        }
+        return true;
+    }
+
+    // Drops everything still queued, e.g. the frontier of a truncated flood.
+    size_t discard_pending() {
+        size_t pending = queue_.size();
+        queue_ = {};
+        return pending;
+    }
+
+    int64_t now_us() const { return now_us_; }
+    uint64_t events_processed() const { return events_processed_; }
+    uint64_t forwards_processed() const { return forwards_processed_; }
+    size_t peak_in_flight() const { return peak_in_flight_; }
+    size_t link_count() const { return edges_.size(); }
+    const std::vector<std::unique_ptr<ServerNode>> &nodes() const { return nodes_; }
+    const std::vector<Delivery> &deliveries() const { return deliveries_; }
+    std::mt19937_64 &rng() { return rng_; }
+
+private:
+    static ServerNode::Clock::time_point clock_at(int64_t us) {
+        return ServerNode::Clock::time_point(std::chrono::microseconds(us));
+    }
+
+    void schedule(int node, int sock, const std::string &data, int64_t at_us) {
+        queue_.push({at_us, seq_++, node, sock, data});
+        peak_in_flight_ = std::max(peak_in_flight_, queue_.size());
+    }
+
+    ssize_t transmit(int from, int sock, const std::string &data) {
+        auto it = links_[from].find(sock);
+        if (it == links_[from].end()) return -1;
+        const Endpoint &ep = it->second;
+        if (ep.node != CLIENT_SINK) schedule(ep.node, ep.sock, data, now_us_ + ep.latency_us);
+        return (ssize_t)data.size();
+    }
+
+    void record_delivery(const std::string &content) {
+        size_t id = std::stoul(content);
+        if (id >= deliveries_.size()) return;
+        Delivery &d = deliveries_[id];
+        if (d.copies++ == 0) d.first_delivery_us = now_us_;
+    }
+
+    std::mt19937_64 rng_;
+    std::vector<std::unique_ptr<ServerNode>> nodes_;
+    std::vector<std::map<int, Endpoint>> links_;
+    std::vector<int> next_sock_;
+    std::set<std::pair<int, int>> edges_;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> queue_;
+    std::vector<Delivery> deliveries_;
+    int64_t now_us_ = 0;
+    uint64_t seq_ = 0;
+    uint64_t events_processed_ = 0;
+    uint64_t forwards_processed_ = 0;
+    size_t peak_in_flight_ = 0;
+};
+
+static void build_topology(Simulation &sim, const std::string &topology, int n, int degree) {
+    for (int i = 0; i + 1 < n; ++i) sim.link(i, i + 1);
+    if (topology == "line" || n < 3) return;
+    sim.link(n - 1, 0);
+    if (topology == "ring") return;
+
+    // Random mesh: a ring for connectivity plus random chords up to the requested average degree.
+    size_t max_links = (size_t)n * (n - 1) / 2;
+    size_t target = std::min(max_links, (size_t)n * degree / 2);
+    while (sim.link_count() < target) {
+        int a = (int)(sim.rng()() % n);
+        int b = (int)(sim.rng()() % n);
+        if (a == b || sim.has_link(a, b)) continue;
+        sim.link(a, b);
+    }
+}
+
+struct MessageResult {
+    bool complete;
+    uint64_t forwards;
+    size_t pending;
+};
+
+static int64_t percentile(std::vector<int64_t> &v, double p) {
+    if (v.empty()) return 0;
+    size_t idx = std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5));
+    return v[idx];
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <line|ring|mesh> <nodes> [messages] [mesh_degree] [seed] [max_events_per_message]\n";
+        return 1;
+    }
+    std::string topology = argv[1];
+    if (topology != "line" && topology != "ring" && topology != "mesh") {
+        std::cerr << "Unknown topology: " << topology << "\n";
+        return 1;
+    }
+    int n = atoi(argv[2]);
+    int messages = argc > 3 ? atoi(argv[3]) : 100;
+    int degree = argc > 4 ? atoi(argv[4]) : 4;
+    uint64_t seed = argc > 5 ? strtoull(argv[5], nullptr, 10) : 1;
+    uint64_t max_events = argc > 6 ? strtoull(argv[6], nullptr, 10) : 100000;
+    if (n < 2 || messages < 0) {
+        std::cerr << "Need at least 2 nodes and a non-negative message count\n";
+        return 1;
+    }
+
+    Logger::set_enabled(false);
+
+    Simulation sim(n, seed);
+    build_topology(sim, topology, n, degree);
+    if (!sim.run(max_events)) {
+        std::cerr << "Topology setup did not settle within " << max_events << " events\n";
+        return 2;
+    }
+    uint64_t setup_events = sim.events_processed();
+
+    uint64_t payloads_before = 0;
+    for (auto const &node : sim.nodes()) payloads_before += node->stats().payloads_handled;
+
+    // Each message floods on its own with its own event budget, so one
+    // runaway flood cannot starve or contaminate the others.
+    std::vector<MessageResult> results;
+    auto msg_start = std::chrono::steady_clock::now();
+    for (int k = 0; k < messages; ++k) {
+        int src = (int)(sim.rng()() % n);
+        int dst = (int)(sim.rng()() % (n - 1));
+        if (dst >= src) ++dst;
+        uint64_t forwards_before = sim.forwards_processed();
+        sim.inject(src, dst, sim.now_us() + 1000);
+        bool complete = sim.run(max_events);
+        size_t pending = sim.discard_pending();
+        results.push_back({complete, sim.forwards_processed() - forwards_before, pending});
+    }
+    double msg_wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - msg_start).count();
+
+    uint64_t payloads = 0;
+    size_t mem_total = 0, mem_max = 0;
+    for (auto const &node : sim.nodes()) {
+        payloads += node->stats().payloads_handled;
+        size_t m = node->memory_usage();
+        mem_total += m;
+        mem_max = std::max(mem_max, m);
+    }
+    uint64_t msg_payloads = payloads - payloads_before;
+
+    uint64_t completed = 0, delivered = 0, copies = 0, forwards = 0, max_forwards = 0;
+    uint64_t trunc_forwards = 0, trunc_pending = 0;
+    std::vector<int64_t> latencies;
+    for (size_t k = 0; k < results.size(); ++k) {
+        const MessageResult &r = results[k];
+        if (!r.complete) {
+            trunc_forwards += r.forwards;
+            trunc_pending += r.pending;
+            continue;
+        }
+        const Delivery &d = sim.deliveries()[k];
+        ++completed;
+        forwards += r.forwards;
+        max_forwards = std::max(max_forwards, r.forwards);
+        copies += d.copies;
+        if (d.first_delivery_us >= 0) {
+            ++delivered;
+            latencies.push_back(d.first_delivery_us - d.injected_us);
+        }
+    }
+    uint64_t truncated = results.size() - completed;
+    std::sort(latencies.begin(), latencies.end());
+    double avg_latency = 0;
+    for (int64_t l : latencies) avg_latency += l;
+    if (!latencies.empty()) avg_latency /= latencies.size();
+
+    std::printf("topology            %s (%d nodes, %zu links, seed %llu)\n", topology.c_str(), n,
+                sim.link_count(), (unsigned long long)seed);
+    std::printf("events              %llu (setup %llu), peak in flight %zu, budget %llu per message\n",
+                (unsigned long long)sim.events_processed(), (unsigned long long)setup_events,
+                sim.peak_in_flight(), (unsigned long long)max_events);
+    std::printf("messages            %d injected, %llu flooded to completion, %llu TRUNCATED\n", messages,
+                (unsigned long long)completed, (unsigned long long)truncated);
+    if (completed > 0) {
+        std::printf("  delivered         %llu of %llu, %llu stored copies\n", (unsigned long long)delivered,
+                    (unsigned long long)completed, (unsigned long long)copies);
+        std::printf("  amplification     avg %.2f, max %llu processed forwards per message\n",
+                    (double)forwards / completed, (unsigned long long)max_forwards);
+        std::printf("  latency (virtual) avg %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms (%zu samples)\n",
+                    avg_latency / 1000.0, percentile(latencies, 0.50) / 1000.0,
+                    percentile(latencies, 0.99) / 1000.0, (latencies.empty() ? 0 : latencies.back()) / 1000.0,
+                    latencies.size());
+    } else {
+        std::printf("  per-message metrics n/a: no flood completed within the budget\n");
+    }
+    if (truncated > 0) {
+        // Lower bounds only: the flood was still growing when it was cut off.
+        std::printf("  truncated floods  avg >= %.0f processed forwards, %.0f frames still pending at cutoff\n",
+                    (double)trunc_forwards / truncated, (double)trunc_pending / truncated);
+    }
+    std::printf("memory per node     avg %zu B, max %zu B (estimated)\n", mem_total / n, mem_max);
+    std::printf("throughput (wall)   %.0f messages/s, %.0f payloads/s (%d messages, %llu payloads in %.3f s)\n",
+                msg_wall_s > 0 ? messages / msg_wall_s : 0.0, msg_wall_s > 0 ? msg_payloads / msg_wall_s : 0.0,
+                messages, (unsigned long long)msg_payloads, msg_wall_s);
+    return truncated == 0 ? 0 : 2;
+}